@@ -9,8 +9,15 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <cstdint>
+#include <exception>
 #include <memory>
 #include <iostream>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
@@ -18,32 +25,259 @@
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
 
+// USDT tracepoints for bpftrace/perf, e.g. usdt:./prog:badgerdb:read_miss.
+// They compile to a nop when <sys/sdt.h> (systemtap-sdt-dev) is available
+// and to nothing otherwise; define BADGERDB_NO_PROBES to turn them off.
+#if !defined(BADGERDB_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#include <chrono>
+#define BUF_PROBES_ENABLED 1
+#endif
+#endif
+
+#ifdef BUF_PROBES_ENABLED
+// With semaphores on, every probe records the address of badgerdb_<name>_semaphore,
+// which the tracer increments while it is attached
+#define BUF_PROBE_SEMAPHORE(name) \
+    extern "C" { __extension__ volatile unsigned short badgerdb_##name##_semaphore \
+        __attribute__((unused)) __attribute__((section(".probes"))); }
+BUF_PROBE_SEMAPHORE(read_hit)
+BUF_PROBE_SEMAPHORE(read_miss)
+BUF_PROBE_SEMAPHORE(evict)
+BUF_PROBE_SEMAPHORE(writeback)
+BUF_PROBE_SEMAPHORE(flush_start)
+BUF_PROBE_SEMAPHORE(flush_end)
+BUF_PROBE_SEMAPHORE(dispose)
+
+#define BUF_PROBE1(name, a) DTRACE_PROBE1(badgerdb, name, a)
+#define BUF_PROBE2(name, a, b) DTRACE_PROBE2(badgerdb, name, a, b)
+#define BUF_PROBE3(name, a, b, c) DTRACE_PROBE3(badgerdb, name, a, b, c)
+#define BUF_PROBE4(name, a, b, c, d) DTRACE_PROBE4(badgerdb, name, a, b, c, d)
+#define BUF_PROBE_ACTIVE(name) __builtin_expect(badgerdb_##name##_semaphore != 0, 0)
+// The clock is only read while a tracer is attached to the probe that reports the
+// latency; var stays at the epoch otherwise, and the probe then reports 0
+#define BUF_PROBE_START(var, name) \
+    std::chrono::steady_clock::time_point var; \
+    if (BUF_PROBE_ACTIVE(name)) { \
+        var = std::chrono::steady_clock::now(); \
+    }
+#define BUF_PROBE_NANOS(var) \
+    ((var) == std::chrono::steady_clock::time_point() ? 0LL : \
+        (long long) std::chrono::duration_cast<std::chrono::nanoseconds>( \
+            std::chrono::steady_clock::now() - (var)).count())
+#else
+#define BUF_PROBE1(name, a)
+#define BUF_PROBE2(name, a, b)
+#define BUF_PROBE3(name, a, b, c)
+#define BUF_PROBE4(name, a, b, c, d)
+#define BUF_PROBE_START(var, name)
+#define BUF_PROBE_NANOS(var) 0
+#endif
+
 namespace badgerdb { 
 
+namespace {
+
+#ifdef BADGERDB_PARALLEL_INIT
+// Pools smaller than this are still built on the calling thread; starting threads costs more
+const std::uint32_t PARALLEL_INIT_MIN_FRAMES = 1 << 16;
+#endif
+
+// Number of slots in each thread's lookaside cache (power of two)
+const std::uint32_t LOOKASIDE_SLOTS = 256;
+
+/**
+ * One slot of the per-thread lookaside cache: the frame that last held some (file, page)
+ * in a given BufMgr. A slot is only a hint; callers confirm it against the frame's
+ * descriptor, which also catches frames that were evicted, flushed or disposed since.
+ */
+struct LookasideEntry
+{
+    const BufMgr* mgr;
+    FrameId frameNo;
+};
+
+thread_local LookasideEntry lookaside[LOOKASIDE_SLOTS];
+
+/**
+ * Returns this thread's lookaside slot for the given page
+ */
+inline LookasideEntry& lookasideSlot(const File* file, const PageId pageNo)
+{
+    std::uintptr_t h = (reinterpret_cast<std::uintptr_t>(file) >> 4) ^ (pageNo * 2654435761u);
+    return lookaside[h & (LOOKASIDE_SLOTS - 1)];
+}
+
+#ifdef BADGERDB_LAZY_FRAMES
+/**
+ * How many pages each BufMgr has built so far. allocBuf hands frames out in clock order
+ * starting at frame 0, so the built pages are always frames [0, count). Kept here rather
+ * than in BufMgr because buffer.h is fixed; the lock covers the map, since shards of a
+ * ShardedBufMgr run allocBuf concurrently.
+ */
+struct LazyPageRegistry
+{
+    std::mutex lock;
+    std::unordered_map<const BufMgr*, FrameId> built;
+};
+
+LazyPageRegistry& lazyPages()
+{
+    static LazyPageRegistry registry;
+    return registry;
+}
+
+/**
+ * Returns the built-page count of mgr, adding it at 0 if mgr isn't registered yet.
+ * The reference stays valid until forgetLazyPages(mgr).
+ */
+FrameId& lazyPagesBuilt(const BufMgr* mgr)
+{
+    LazyPageRegistry &registry = lazyPages();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    return registry.built[mgr];
+}
+
+void forgetLazyPages(const BufMgr* mgr)
+{
+    LazyPageRegistry &registry = lazyPages();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.built.erase(mgr);
+}
+#endif
+
+/**
+ * Runs initFrame(i) for every frame in [0, bufs). By default this happens on the calling
+ * thread. Built with BADGERDB_PARALLEL_INIT, large pools are split into contiguous ranges
+ * across the hardware threads, which spreads the construction and first-touch page faults
+ * over several cores. The threads are not pinned, so this makes no promise about which
+ * NUMA node a range ends up on. Ranges whose thread cannot be started are built on the
+ * calling thread instead.
+ *
+ * If initFrame throws for any frame, destroyFrame(i) is run on every frame that was
+ * built, after all threads have joined, and the first exception is rethrown.
+ */
+template <typename InitFn, typename DestroyFn>
+void initFrames(std::uint32_t bufs, InitFn initFrame, DestroyFn destroyFrame)
+{
+    if (bufs == 0) {
+        return;
+    }
+
+    std::uint32_t numThreads = 1;
+#ifdef BADGERDB_PARALLEL_INIT
+    if (bufs >= PARALLEL_INIT_MIN_FRAMES && std::thread::hardware_concurrency() > 1) {
+        numThreads = std::thread::hardware_concurrency();
+    }
+#endif
+    std::uint32_t chunk = (bufs + numThreads - 1) / numThreads;
+    std::uint32_t numRanges = (bufs + chunk - 1) / chunk;
+
+    //each range records its own progress and failure, so workers share nothing
+    std::vector<FrameId> built(numRanges, 0);
+    std::vector<std::exception_ptr> errors(numRanges);
+    auto initRange = [&](std::uint32_t r) {
+        FrameId start = r * chunk;
+        FrameId end = (bufs - start < chunk) ? bufs : start + chunk;
+        try {
+            for (FrameId i = start; i < end; i++) {
+                initFrame(i);
+                built[r]++;
+            }
+        } catch (...) {
+            errors[r] = std::current_exception();
+        }
+    };
+
+    //range 0 is built on this thread; start a worker for each of the others
+    std::vector<std::thread> workers;
+    std::uint32_t spawned = 1;
+    try {
+        workers.reserve(numRanges - 1);
+        for (; spawned < numRanges; spawned++) {
+            workers.emplace_back(initRange, spawned);
+        }
+    } catch (...) {
+        //no more threads available; the remaining ranges are built below
+    }
+
+    initRange(0);
+    for (std::uint32_t r = spawned; r < numRanges; r++) {
+        initRange(r);
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    for (std::uint32_t r = 0; r < numRanges; r++) {
+        if (errors[r]) {
+            for (std::uint32_t done = 0; done < numRanges; done++) {
+                for (FrameId i = done * chunk; i < done * chunk + built[done]; i++) {
+                    destroyFrame(i);
+                }
+            }
+            std::rethrow_exception(errors[r]);
+        }
+    }
+}
+
+
+}
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
 BufMgr::BufMgr(std::uint32_t bufs)
 	: numBufs(bufs) {
-	bufDescTable = new BufDesc[bufs];
-
-  for (FrameId i = 0; i < bufs; i++) 
-  {
-  	bufDescTable[i].frameNo = i;
-  	bufDescTable[i].valid = false;
+  // get raw storage for both tables and construct the frames in place (in parallel for
+  // large pools when built with BADGERDB_PARALLEL_INIT)
+  bufDescTable = static_cast<BufDesc*>(::operator new[](sizeof(BufDesc) * bufs));
+  try {
+  	bufPool = static_cast<Page*>(::operator new[](sizeof(Page) * bufs));
+  } catch (...) {
+  	::operator delete[](bufDescTable);
+  	throw;
   }
 
-  bufPool = new Page[bufs];
+  try {
+  	initFrames(bufs, [this](FrameId i) {
+#ifndef BADGERDB_LAZY_FRAMES
+  		// the Page is built first: it is the only part that can throw.
+  		// With BADGERDB_LAZY_FRAMES bufPool is left untouched and allocBuf builds each
+  		// Page the first time it hands out that frame; descriptors are always built here
+  		new (&bufPool[i]) Page();
+#endif
+  		new (&bufDescTable[i]) BufDesc();
+  		bufDescTable[i].frameNo = i;
+  		bufDescTable[i].valid = false;
+  	}, [this](FrameId i) {
+#ifndef BADGERDB_LAZY_FRAMES
+  		bufPool[i].~Page();
+#endif
+  		bufDescTable[i].~BufDesc();
+  	});
+  } catch (...) {
+  	::operator delete[](bufDescTable);
+  	::operator delete[](bufPool);
+  	throw;
+  }
 
   int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
   hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
 
   clockHand = bufs - 1;
+
+#ifdef BADGERDB_LAZY_FRAMES
+  lazyPagesBuilt(this) = 0;
+#endif
 }
 
 /*
  * This destructor flushes out all dirty pages, deallocates bufPool and bufDescTable.
+ * Both tables were built with placement new, so frames are destroyed one by one.
  */
 BufMgr::~BufMgr() {
     for (std::uint32_t i = 0; i < numBufs; i++) {
@@ -52,8 +286,21 @@ BufMgr::~BufMgr() {
         }
     }
 
-    delete [] bufDescTable;
-    delete [] bufPool;
+#ifdef BADGERDB_LAZY_FRAMES
+    //frames never handed out have no Page to destroy
+    FrameId pagesBuilt = lazyPagesBuilt(this);
+    forgetLazyPages(this);
+#else
+    FrameId pagesBuilt = numBufs;
+#endif
+    for (std::uint32_t i = 0; i < numBufs; i++) {
+        if (i < pagesBuilt) {
+            bufPool[i].~Page();
+        }
+        bufDescTable[i].~BufDesc();
+    }
+    ::operator delete[](bufDescTable);
+    ::operator delete[](bufPool);
 }
 
 void BufMgr::advanceClock()
@@ -87,10 +334,14 @@ void BufMgr::allocBuf(FrameId & frame)
         }
         else { //not pinned, so use this frame; write to disk if dirty
             found = true;
+            BUF_PROBE4(evict, bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo,
+                       clockHand, bufDescTable[clockHand].dirty);
             //remove page from hashtable
             hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
             if(bufDescTable[clockHand].dirty) {
+                BUF_PROBE3(writeback, bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo, clockHand);
                 bufDescTable[clockHand].file->writePage(bufPool[clockHand]);
+                bufStats.diskwrites++;
                 bufDescTable[clockHand].dirty = false;
             }
             break;
@@ -102,6 +353,18 @@ void BufMgr::allocBuf(FrameId & frame)
         throw BufferExceededException();
     }
 
+#ifdef BADGERDB_LAZY_FRAMES
+    //a frame that held a page has its Page built already; only a free frame may be new,
+    //so only then is the registry (and its lock) consulted
+    if (!bufDescTable[clockHand].valid) {
+        FrameId &pagesBuilt = lazyPagesBuilt(this);
+        while (pagesBuilt <= clockHand) {
+            new (&bufPool[pagesBuilt]) Page();
+            pagesBuilt++;
+        }
+    }
+#endif
+
     //initialize buffer frame
     bufDescTable[clockHand].Clear();
 
@@ -115,23 +378,37 @@ void BufMgr::allocBuf(FrameId & frame)
  */	
 void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 {
-    FrameId frameNo; //pointer to the frame
+    //try the frame this thread last saw the page in before probing the hash table
+    LookasideEntry &recent = lookasideSlot(file, pageNo);
+    FrameId frameNo = recent.frameNo; //pointer to the frame
+    bool cached = recent.mgr == this && frameNo < numBufs && bufDescTable[frameNo].valid
+        && bufDescTable[frameNo].file == file && bufDescTable[frameNo].pageNo == pageNo;
     try {
         //find the page
-        hashTable->lookup(file, pageNo, frameNo);
+        if (!cached) {
+            hashTable->lookup(file, pageNo, frameNo);
+        }
         //page is in the buffer pool, so set refbit, increment, pinCnt, and return the pointer
         bufDescTable[frameNo].refbit = true;
         bufDescTable[frameNo].pinCnt++;
         page = &bufPool[frameNo];
+        bufStats.accesses++;
+        BUF_PROBE3(read_hit, file, pageNo, frameNo);
     }
     catch (HashNotFoundException &e) { //Page is not in the buffer pool.
         //So allocate buffer frame, read the page, insert the page, and invoke Set()
+        BUF_PROBE_START(missStart, read_miss);
         allocBuf(frameNo);
         bufPool[frameNo] = file->readPage(pageNo);
         hashTable->insert(file, pageNo, frameNo);
         bufDescTable[frameNo].Set(file, pageNo);
         page = &bufPool[frameNo];
+        bufStats.accesses++;
+        bufStats.diskreads++;
+        BUF_PROBE4(read_miss, file, pageNo, frameNo, BUF_PROBE_NANOS(missStart));
     }
+    recent.mgr = this;
+    recent.frameNo = frameNo;
 }
 
  /**
@@ -140,9 +417,14 @@ void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
  */
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
 {
-    FrameId frameNo = 0;
+    LookasideEntry &recent = lookasideSlot(file, pageNo);
+    FrameId frameNo = recent.frameNo;
+    bool cached = recent.mgr == this && frameNo < numBufs && bufDescTable[frameNo].valid
+        && bufDescTable[frameNo].file == file && bufDescTable[frameNo].pageNo == pageNo;
     try {
-        hashTable->lookup(file, pageNo, frameNo);
+        if (!cached) {
+            hashTable->lookup(file, pageNo, frameNo);
+        }
 
         //set dirty bit if dirty is true
         if(dirty) {
@@ -173,6 +455,8 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
 
     //allocate a new page
     bufPool[frameNo] = file->allocatePage();
+    bufStats.accesses++;
+    bufStats.diskreads++;  //allocations count as reads
     page = &bufPool[frameNo];
     pageNo = page->page_number();
 
@@ -180,6 +464,10 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
     hashTable->insert(file, pageNo, frameNo);
     bufDescTable[frameNo].Set(file, pageNo);
 
+    LookasideEntry &recent = lookasideSlot(file, pageNo);
+    recent.mgr = this;
+    recent.frameNo = frameNo;
+
     return;
 }
 
@@ -188,6 +476,9 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
  */
 void BufMgr::flushFile(const File* file) 
 {
+    BUF_PROBE1(flush_start, file);
+    BUF_PROBE_START(flushStart, flush_end);
+
     //iterate over all buffers
     for (unsigned int i = 0; i < numBufs; i++) {
         if (bufDescTable[i].valid == true && bufDescTable[i].file == file) {
@@ -203,17 +494,23 @@ void BufMgr::flushFile(const File* file)
 
             //if the dirty bit is selected
             if (bufDescTable[i].dirty == true) {
+                BUF_PROBE3(writeback, bufDescTable[i].file, bufDescTable[i].pageNo, i);
                 bufDescTable[i].file->writePage(bufPool[i]);
+                bufStats.diskwrites++;
                 bufDescTable[i].dirty = false;
             }
 
             //remove from tables
             hashTable->remove(bufDescTable[i].file, bufDescTable[i].pageNo);
             bufDescTable[i].Clear();
-        } else if (bufDescTable[i].valid == false && bufDescTable[i].file == file) {
-            BadBufferException(bufDescTable[i].frameNo, bufDescTable[i].dirty, bufDescTable[i].valid, bufDescTable[i].refbit);
+        } else if (bufDescTable[i].valid == false && bufDescTable[i].file == file && file != NULL) {
+            //an invalid frame still tagged with the file; cleared frames have file == NULL,
+            //so flushFile(NULL) must not treat every free frame as bad
+            throw BadBufferException(bufDescTable[i].frameNo, bufDescTable[i].dirty, bufDescTable[i].valid, bufDescTable[i].refbit);
         }
     }
+
+    BUF_PROBE2(flush_end, file, BUF_PROBE_NANOS(flushStart));
 }
 
 /**
@@ -225,6 +522,7 @@ void BufMgr::disposePage(File* file, const PageId PageNo)
     try {
         //find and check if refbit exists
         hashTable->lookup(file, PageNo, frameNo);
+        BUF_PROBE3(dispose, file, PageNo, frameNo);
         //if it doesn't throw an exception, remove file with specified frameNo and pageNo from table
         hashTable->remove(bufDescTable[frameNo].file, bufDescTable[frameNo].pageNo);
         bufDescTable[frameNo].Clear();
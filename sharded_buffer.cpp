@@ -0,0 +1,149 @@
+/**
+ * @author Ziwei Ren 9079858370, William Hofkamp 9073969520, Mitchell McClure 
+ * 
+ * This file is the sharded_buffer.cpp file which routes page requests to one of several
+ *  independent buffer managers by file, so that threads working on files in different
+ *  shards do not wait on each other.
+ * 
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include "sharded_buffer.h"
+
+namespace badgerdb { 
+
+namespace {
+
+/**
+ * Returns how many shards to build for a pool of bufs frames: shardCount, but at least 1
+ * and at most bufs, because a shard with no frames would divide by zero in advanceClock.
+ * A pool with no frames at all is rejected.
+ */
+std::uint32_t clampShardCount(std::uint32_t bufs, std::uint32_t shardCount)
+{
+    if (bufs == 0) {
+        throw std::invalid_argument("ShardedBufMgr needs at least one buffer frame");
+    }
+    if (shardCount == 0) {
+        return 1;
+    }
+    return shardCount < bufs ? shardCount : bufs;
+}
+
+}
+
+//----------------------------------------
+// Constructor of the class ShardedBufMgr
+//----------------------------------------
+
+ShardedBufMgr::ShardedBufMgr(std::uint32_t bufs, std::uint32_t shardCount)
+	: numShards(clampShardCount(bufs, shardCount)), shardLocks(numShards) {
+  for (std::uint32_t i = 0; i < numShards; i++)
+  {
+    //give the first (bufs % numShards) shards one extra frame
+    std::uint32_t shardBufs = bufs / numShards + (i < bufs % numShards ? 1 : 0);
+    shards.push_back(std::unique_ptr<BufMgr>(new BufMgr(shardBufs)));
+  }
+}
+
+/**
+ * Maps the file pointer to a shard index. Pointers are aligned, so the low bits are
+ * dropped before taking the modulus.
+ */
+std::uint32_t ShardedBufMgr::shardOf(const File* file) const
+{
+    std::size_t h = std::hash<const File*>()(file) >> 4;
+    h ^= h >> 16;
+    return h % numShards;
+}
+
+/**
+ * Reads in a page using the shard that owns its file
+ */
+void ShardedBufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+{
+    std::uint32_t s = shardOf(file);
+    std::lock_guard<std::mutex> guard(shardLocks[s]);
+    shards[s]->readPage(file, pageNo, page);
+}
+
+/**
+ * Unpins a page using the shard that owns its file
+ */
+void ShardedBufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
+{
+    std::uint32_t s = shardOf(file);
+    std::lock_guard<std::mutex> guard(shardLocks[s]);
+    shards[s]->unPinPage(file, pageNo, dirty);
+}
+
+/**
+ * Allocates a new page for a file using the shard that owns the file. BufMgr::allocPage
+ * gets a frame before touching the file, so a full shard leaves no orphan page behind.
+ */
+void ShardedBufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
+{
+    std::uint32_t s = shardOf(file);
+    std::lock_guard<std::mutex> guard(shardLocks[s]);
+    shards[s]->allocPage(file, pageNo, page);
+}
+
+/**
+ * Flushes the file from the shard that owns it
+ */
+void ShardedBufMgr::flushFile(const File* file)
+{
+    std::uint32_t s = shardOf(file);
+    std::lock_guard<std::mutex> guard(shardLocks[s]);
+    shards[s]->flushFile(file);
+}
+
+/**
+ * Disposes a page using the shard that owns its file
+ */
+void ShardedBufMgr::disposePage(File* file, const PageId pageNo)
+{
+    std::uint32_t s = shardOf(file);
+    std::lock_guard<std::mutex> guard(shardLocks[s]);
+    shards[s]->disposePage(file, pageNo);
+}
+
+void ShardedBufMgr::printSelf(void)
+{
+  for (std::uint32_t i = 0; i < numShards; i++)
+  {
+    std::lock_guard<std::mutex> guard(shardLocks[i]);
+    std::cout << "Shard:" << i << "\n";
+    shards[i]->printSelf();
+  }
+}
+
+/**
+ * Adds up the statistics of all shards
+ */
+BufStats ShardedBufMgr::getBufStats()
+{
+    BufStats total;
+    for (std::uint32_t i = 0; i < numShards; i++) {
+        std::lock_guard<std::mutex> guard(shardLocks[i]);
+        BufStats &stats = shards[i]->getBufStats();
+        total.accesses += stats.accesses;
+        total.diskreads += stats.diskreads;
+        total.diskwrites += stats.diskwrites;
+    }
+    return total;
+}
+
+void ShardedBufMgr::clearBufStats()
+{
+    for (std::uint32_t i = 0; i < numShards; i++) {
+        std::lock_guard<std::mutex> guard(shardLocks[i]);
+        shards[i]->clearBufStats();
+    }
+}
+
+}
@@ -0,0 +1,104 @@
+/**
+ * @author Ziwei Ren 9079858370, William Hofkamp 9073969520, Mitchell McClure 
+ * 
+ * This file is the sharded_buffer.h file which declares a buffer manager that splits the
+ *  buffer pool into several independent BufMgr instances, each guarded by its own mutex.
+ * 
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "buffer.h"
+
+namespace badgerdb { 
+
+/**
+ * Buffer manager made of several independent BufMgr shards. All pages of a file are handled
+ * by the one shard picked by hashing its File pointer.
+ *
+ * File isn't thread-safe, and a BufMgr can do I/O on any file it holds pages of (a miss may
+ * evict and write back another file's dirty page). Since a file's pages only ever live in
+ * its own shard, every read and write of a File happens under that shard's mutex, so any
+ * number of threads may use any files concurrently. The price is that threads working on
+ * the same file, or on files that hash to the same shard, run one at a time.
+ */
+class ShardedBufMgr
+{
+ private:
+  /**
+   * Number of shards
+   */
+  std::uint32_t numShards;
+
+  /**
+   * The shards, each one a normal buffer manager
+   */
+  std::vector<std::unique_ptr<BufMgr>> shards;
+
+  /**
+   * One mutex per shard
+   */
+  std::vector<std::mutex> shardLocks;
+
+  /**
+   * Returns the index of the shard that holds the pages of the given file
+   */
+  std::uint32_t shardOf(const File* file) const;
+
+ public:
+  /**
+   * Constructor. Splits bufs frames as evenly as possible over shardCount instances.
+   * shardCount is capped at bufs so that every shard has at least one frame, and bufs == 0
+   * throws std::invalid_argument. Deleting the ShardedBufMgr deletes every shard, which
+   * flushes its dirty pages.
+   */
+  ShardedBufMgr(std::uint32_t bufs, std::uint32_t shardCount);
+
+  /**
+   * Reads a page through the shard that owns its file
+   */
+  void readPage(File* file, const PageId PageNo, Page*& page);
+
+  /**
+   * Unpins a page in the shard that owns its file
+   */
+  void unPinPage(File* file, const PageId PageNo, const bool dirty);
+
+  /**
+   * Allocates a new page in the file and pins it in the shard that owns the file
+   */
+  void allocPage(File* file, PageId &PageNo, Page*& page);
+
+  /**
+   * Flushes the pages of the file from the shard that owns it
+   */
+  void flushFile(const File* file);
+
+  /**
+   * Disposes a page through the shard that owns its file
+   */
+  void disposePage(File* file, const PageId PageNo);
+
+  /**
+   * Prints the frames of every shard
+   */
+  void printSelf();
+
+  /**
+   * Returns the usage statistics summed over all shards
+   */
+  BufStats getBufStats();
+
+  /**
+   * Clears the usage statistics of every shard
+   */
+  void clearBufStats();
+};
+
+}
@@ -0,0 +1,143 @@
+/**
+ * @author Ziwei Ren 9079858370, William Hofkamp 9073969520, Mitchell McClure
+ *
+ * This file is the sharded_buffer_test.cpp file which stress tests ShardedBufMgr: several
+ *  threads allocate, write, re-read and dispose pages of shared files at the same time,
+ *  with a pool small enough that every shard keeps evicting dirty pages. It is built like
+ *  main.cpp, against the BadgerDB sources plus buffer.cpp and sharded_buffer.cpp.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "file.h"
+#include "page.h"
+#include "sharded_buffer.h"
+#include "exceptions/file_not_found_exception.h"
+
+#define PRINT_ERROR(str) \
+{ \
+	std::cerr << "On Line No:" << __LINE__ << "\n"; \
+	std::cerr << str << "\n"; \
+	exit(1); \
+}
+
+using namespace badgerdb;
+
+const int NUM_THREADS = 8;
+const int NUM_FILES = 4;          // two threads share each file
+const int NUM_PAGES = 200;        // pages allocated by each thread
+const int NUM_ROUNDS = 5;         // times each thread re-reads its pages
+const std::uint32_t NUM_BUFS = 64;
+const std::uint32_t NUM_SHARDS = 4;
+
+ShardedBufMgr* bufMgr;
+std::vector<File> files;
+
+std::string recordFor(int thread, int i)
+{
+	return "thread " + std::to_string(thread) + " page " + std::to_string(i);
+}
+
+/**
+ * Allocates NUM_PAGES pages in this thread's file, then re-reads and re-dirties them in
+ * a different order every round, checking the contents each time. Every other page is
+ * disposed at the end; the rest are checked again after the final flush.
+ */
+void worker(int thread, std::vector<PageId>* pageNos, std::vector<RecordId>* rids)
+{
+	File* file = &files[thread % NUM_FILES];
+	Page* page;
+
+	for (int i = 0; i < NUM_PAGES; i++)
+	{
+		PageId pageNo;
+		bufMgr->allocPage(file, pageNo, page);
+		rids->push_back(page->insertRecord(recordFor(thread, i)));
+		pageNos->push_back(pageNo);
+		bufMgr->unPinPage(file, pageNo, true);
+	}
+
+	for (int round = 0; round < NUM_ROUNDS; round++)
+	{
+		for (int j = 0; j < NUM_PAGES; j++)
+		{
+			int i = (j * 7 + round * 13) % NUM_PAGES;
+			bufMgr->readPage(file, (*pageNos)[i], page);
+			if (page->getRecord((*rids)[i]) != recordFor(thread, i))
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			bufMgr->unPinPage(file, (*pageNos)[i], round % 2 == 0);
+		}
+	}
+
+	for (int i = 1; i < NUM_PAGES; i += 2)
+	{
+		bufMgr->disposePage(file, (*pageNos)[i]);
+	}
+}
+
+int main()
+{
+	std::vector<std::string> filenames;
+	for (int f = 0; f < NUM_FILES; f++)
+	{
+		filenames.push_back("shardtest." + std::to_string(f));
+		try
+		{
+			File::remove(filenames[f]);
+		}
+		catch (FileNotFoundException &e)
+		{
+		}
+		files.push_back(File::create(filenames[f]));
+	}
+
+	bufMgr = new ShardedBufMgr(NUM_BUFS, NUM_SHARDS);
+
+	std::vector<std::vector<PageId>> pageNos(NUM_THREADS);
+	std::vector<std::vector<RecordId>> rids(NUM_THREADS);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < NUM_THREADS; t++)
+	{
+		threads.push_back(std::thread(worker, t, &pageNos[t], &rids[t]));
+	}
+	for (std::thread &t : threads)
+	{
+		t.join();
+	}
+
+	//flush, then read the surviving pages straight from the files
+	for (int f = 0; f < NUM_FILES; f++)
+	{
+		bufMgr->flushFile(&files[f]);
+	}
+	for (int t = 0; t < NUM_THREADS; t++)
+	{
+		for (int i = 0; i < NUM_PAGES; i += 2)
+		{
+			Page page = files[t % NUM_FILES].readPage(pageNos[t][i]);
+			if (page.getRecord(rids[t][i]) != recordFor(t, i))
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH AFTER FLUSH");
+			}
+		}
+	}
+
+	delete bufMgr;
+	files.clear();
+	for (int f = 0; f < NUM_FILES; f++)
+	{
+		File::remove(filenames[f]);
+	}
+
+	std::cout << "Sharded buffer stress test passed" << "\n";
+	return 0;
+}